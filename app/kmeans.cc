@@ -37,8 +37,12 @@
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sched.h>
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
 #include "application.hh"
 #include "bench.hh"
+#include "dense.hh"
 
 #define DEF_NUM_POINTS 100000
 #define DEF_NUM_MEANS 100
@@ -54,84 +58,55 @@ static int num_means;		// number of clusters
 static int grid_size;		// size of each dimension of vector space
 static int modified;
 
-static int *inbuf_start = NULL;
-static int *inbuf_end = NULL;
-
-enum { with_value_modifier = 0 };
-enum { with_combiner = 1 };
-
-static volatile int scanned = 0;
-static volatile long *stats = 0;
-static pthread_mutex_t lock;
+/* The points are stored by dimension: coordinate d of point i is
+   points[d * stride + i]. The distance kernel takes lanes points at a
+   time, so stride and the splits are multiples of lanes. */
+enum { lanes = 8, means_per_pass = 4 };
 
 struct kmeans_data_t {
-    int **points;
-    keyval_t *means;		// each mean is an index and a coordinate.
+    int *points;
+    size_t stride;
+    int *means;			// the coordinates of the means, packed
     int *clusters;
     int next_point;
-    int unit_size;
     int nsplits;
 };
 
 struct kmeans_map_data_t {
-    int nsplits;
+    int start;
     int length;
-    int **points;
-    keyval_t *means;
-    int *clusters;
 };
 
-struct kmeans : public map_reduce {
+/* Row c of the job is the number of points of cluster c, followed by
+   the sum of their coordinates. */
+struct kmeans : public map_dense<int> {
+    kmeans() : map_dense<int>(num_means, dim + 1) {}
     void map_function(split_t *ma);
-    void reduce_function(void *k, void **v, size_t length);
-    int combine_function(void *k, void **v, size_t length);
-    void *inplace_modify(void *oldv, void *newv);
-    unsigned partition(void *k, int) {
-        return ptr2int<unsigned>(k);
-    } 
     bool split(split_t *out, int ncores);
-    bool has_value_modifier() {
-        return with_value_modifier;
-    }
-    int key_compare(const void *s1, const void *s2) {
-        prof_enterkcmp();
-        int r = *((int *)s1) - *((int *)s2);
-        prof_leavekcmp();
-        return r;
-    }
+    /* @brief: move each mean to the center of its cluster */
+    void update_means();
+    /* @brief: pad the means to a multiple of means_per_pass with copies
+       of the last mean */
+    void pad_means();
     kmeans_data_t kd_;
-  private:
-    void find_clusters(int **points, keyval_t * means, int *clusters, int size);
 };
 
 /** dump_means()
  *  Helper function to Print out the mean values
  */
-static void dump_means(keyval_t * means, int size) {
+static void dump_means(const int *means, int size) {
     for (int i = 0; i < size; ++i) {
 	for (int j = 0; j < dim; ++j)
-	    printf("%5d ", ((int *) means[i].val)[j]);
+	    printf("%5d ", means[i * dim + j]);
 	printf("\n");
     }
 }
 
-#if 0
-/** Helper function to print out the points */
-static void dump_points(int **vals, int rows) {
-    for (int i = 0; i < rows; i++) {
-	for (int j = 0; j < dim; j++)
-	    printf("%5d ", vals[i][j]);
-	printf("\n");
-    }
-}
-#endif
-
 static void usage(char *fn) {
     printf("Usage: %s <vector dimension> <num clusters> <num points> <max value> [options]\n", fn);
     printf("options:\n");
     printf("  -p nprocs : # of processors to use\n");
     printf("  -m map mask : # of map mask (pre-split input before MR)\n");
-    printf("  -r #reduce tasks: # of reduce tasks\n");
     printf("  -l ntops : # of top val. pairs to display\n");
     printf("  -q : quiet output (for batch test)\n");
 }
@@ -157,49 +132,90 @@ static void parse_args(int argc, char **argv) {
 }
 
 /* Generate the points */
-void generate_points(int **pts, int size) {
+static void generate_points(int *pts, size_t stride, int size) {
     for (int i = 0; i < size; i++)
 	for (int j = 0; j < dim; j++)
-	    pts[i][j] = (i * j) % grid_size + 1;
-}
-
-/** Get the squared distance between 2 points */
-unsigned int get_sq_dist(int *v1, int *v2) {
-    unsigned int sum = 0;
-    for (int i = 0; i < dim; i++)
-	sum += ((v1[i] - v2[i]) * (v1[i] - v2[i]));
-    return sum;
+	    pts[j * stride + i] = (i * j) % grid_size + 1;
 }
 
-/** Helper function to update the total distance sum */
-void add_to_sum(int *sum, int *point) {
-    for (int i = 0; i < dim; i++)
-	sum[i] += point[i];
+/* @brief: the index of the nearest mean of each of the lanes points that
+   start at @pts, with the first one winning ties. @means holds the means
+   one after the other, padded to a multiple of means_per_pass with copies
+   of the last mean. */
+static void nearest_scalar(const int *pts, size_t stride, const int *means, int *idx) {
+    for (int l = 0; l < lanes; ++l) {
+	unsigned min_dist = 0;
+	for (int j = 0; j < num_means; ++j) {
+	    unsigned dist = 0;
+	    for (int d = 0; d < dim; ++d) {
+		const int diff = pts[d * stride + l] - means[j * dim + d];
+		dist += diff * diff;
+	    }
+	    if (j == 0 || dist < min_dist) {
+		min_dist = dist;
+		idx[l] = j;
+	    }
+	}
+    }
 }
 
-/* Find the cluster that is most suitable for a given set of points */
-void kmeans::find_clusters(int **points, keyval_t *means, int *clusters, int size) {
-    unsigned int min_dist, cur_dist;
-    int min_idx;
-    for (int i = 0; i < size; i++) {
-	min_dist = get_sq_dist(points[i], (int *)means[0].val);
-	min_idx = 0;
-	for (int j = 1; j < num_means; j++) {
-	    cur_dist = get_sq_dist(points[i], (int *)means[j].val);
-	    if (cur_dist < min_dist) {
-		min_dist = cur_dist;
-		min_idx = j;
+#ifdef __x86_64__
+/* @brief: nearest_scalar with the lanes points in one AVX2 register,
+   against means_per_pass means at a time */
+__attribute__((target("avx2")))
+static void nearest_avx2(const int *pts, size_t stride, const int *means, int *idx) {
+    __m256i best = _mm256_set1_epi32(-1), best_idx = _mm256_setzero_si256();
+    for (int j = 0; j < num_means; j += means_per_pass) {
+	__m256i dist[means_per_pass];
+	for (int u = 0; u < means_per_pass; ++u)
+	    dist[u] = _mm256_setzero_si256();
+	for (int d = 0; d < dim; ++d) {
+	    const __m256i p = _mm256_load_si256((const __m256i *)&pts[d * stride]);
+	    for (int u = 0; u < means_per_pass; ++u) {
+		const __m256i diff = _mm256_sub_epi32(p, _mm256_set1_epi32(means[(j + u) * dim + d]));
+		dist[u] = _mm256_add_epi32(dist[u], _mm256_mullo_epi32(diff, diff));
 	    }
 	}
+	for (int u = 0; u < means_per_pass; ++u) {
+	    // lanes where dist >= best keep their mean; the first mean always wins
+	    const __m256i m = _mm256_min_epu32(best, dist[u]);
+	    const __m256i keep = j + u ? _mm256_cmpeq_epi32(m, best) : _mm256_setzero_si256();
+	    best_idx = _mm256_blendv_epi8(_mm256_set1_epi32(j + u), best_idx, keep);
+	    best = m;
+	}
+    }
+    _mm256_storeu_si256((__m256i *)idx, best_idx);
+}
+#endif
 
-	if (clusters[i] != min_idx) {
-	    clusters[i] = min_idx;
-	    modified = true;
+typedef void (*nearest_t)(const int *pts, size_t stride, const int *means, int *idx);
+
+static nearest_t nearest_kernel() {
+#ifdef __x86_64__
+    if (__builtin_cpu_supports("avx2"))
+	return nearest_avx2;
+#endif
+    return nearest_scalar;
+}
+
+/* Find the cluster that is most suitable for a given set of points, and
+   add the points to the rows of their clusters in @sum */
+static void find_clusters(kmeans_data_t &kd, int start, int length, int *sum) {
+    static const nearest_t nearest = nearest_kernel();
+    int idx[lanes];
+    for (int i = start; i < start + length; i += lanes) {
+	nearest(&kd.points[i], kd.stride, kd.means, idx);
+	for (int l = 0; l < lanes && i + l < start + length; ++l) {
+	    const int c = idx[l];
+	    if (kd.clusters[i + l] != c) {
+		kd.clusters[i + l] = c;
+		modified = true;
+	    }
+	    int *row = &sum[c * (dim + 1)];
+	    ++row[0];
+	    for (int d = 0; d < dim; ++d)
+		row[d + 1] += kd.points[d * kd.stride + i + l];
 	}
-	//printf("Emitting [%d,%d]\n", *((int *)means[min_idx].key), *(points[i]));
-	prof_leaveapp();
-	map_emit(means[min_idx].key, (void *)points[i], sizeof(means[min_idx].key));
-	prof_enterapp();
     }
 }
 
@@ -207,7 +223,7 @@ void kmeans::find_clusters(int **points, keyval_t *means, int *clusters, int siz
 bool kmeans::split(split_t *out, int ncores) {
     if (kd_.nsplits == 0)
 	kd_.nsplits = 16 * ncores;
-    int req_units = num_points / kd_.nsplits;
+    const int req_units = round_up(num_points / kd_.nsplits + 1, int(lanes));
     assert(out && kd_.points && kd_.means && kd_.clusters);
     if (kd_.next_point >= num_points)
 	return false;
@@ -215,102 +231,59 @@ bool kmeans::split(split_t *out, int ncores) {
     kmeans_map_data_t *out_data = safe_malloc<kmeans_map_data_t>();
     out->length = 1;
     out->data = (void *) out_data;
-
-    out_data->points = (int **)(&kd_.points[kd_.next_point]);
-    out_data->means = kd_.means;
-    out_data->clusters = (int *) (&kd_.clusters[kd_.next_point]);
+    out_data->start = kd_.next_point;
     out_data->length = std::min(num_points - kd_.next_point, req_units);
     kd_.next_point += out_data->length;
     prof_leaveapp();
     return true;
 }
 
-/** Finds the cluster that is most suitable for a given set of points */
+/** Finds the cluster that is most suitable for a given set of points, and
+ *  adds the points to the sums of the current core */
 void kmeans::map_function(split_t * split) {
     assert(split->length == 1);
     prof_enterapp();
     kmeans_map_data_t *map_data = (kmeans_map_data_t *)split->data;
-    find_clusters(map_data->points, map_data->means, map_data->clusters,
-		  map_data->length);
+    find_clusters(kd_, map_data->start, map_data->length, local());
     free(map_data);
     prof_leaveapp();
 }
 
-void *kmeans::inplace_modify(void *oldv, void *newv) {
-    add_to_sum((int *)oldv, (int *)newv);
-    return oldv;
-}
-
-/** Updates the sum calculation for the various points */
-int kmeans::combine_function(void *key_in, void **vals_in, size_t vals_len) {
-    prof_enterapp();
-    if (!with_combiner) {
-        prof_leaveapp();
-        return vals_len;
+void kmeans::update_means() {
+    const int *sum = results();
+    for (int c = 0; c < num_means; ++c) {
+	const int *row = &sum[c * (dim + 1)];
+	if (!row[0])
+	    continue;
+	for (int d = 0; d < dim; ++d)
+	    kd_.means[c * dim + d] = row[d + 1] / row[0];
     }
-    int *sum = (int *) calloc(dim, sizeof(int));
-    for (size_t i = 0; i < vals_len; i++) {
-	add_to_sum(sum, (int *)vals_in[i]);
-	if (vals_in[i] < inbuf_start || vals_in[i] > inbuf_end)
-	    free(vals_in[i]);
-    }
-    vals_in[0] = sum;
-    prof_leaveapp();
-    return 1;
+    pad_means();
 }
 
-/** Updates the sum calculation for the various points */
-void kmeans::reduce_function(void *key_in, void **vals_in, size_t vals_len) {
-    assert(key_in && vals_in);
-    prof_enterapp();
-    int *sum = (int *) calloc(dim, sizeof(int));
-
-    for (size_t i = 0; i < vals_len; i++)
-	add_to_sum(sum, (int *)vals_in[i]);
-
-    if (!scanned) {
-	pthread_mutex_lock(&lock);
-	if (!scanned) {
-	    long *tmp = safe_malloc<long>(num_means);
-	    memset(tmp, 0, sizeof(long) * num_means);
-	    for (int i = 0; i < num_points; ++i)
-		++tmp[kd_.clusters[i]];
-	    stats = tmp;
-	    scanned = 1;
-	}
-	pthread_mutex_unlock(&lock);
-    }
-    long len = stats[*((int *) key_in)];
-    int *mean = safe_malloc<int>(dim);
-    for (int i = 0; i < dim; i++)
-	mean[i] = sum[i] / len;
-
-    free(sum);
-    prof_leaveapp();
-    reduce_emit(key_in, (void *)mean);
+void kmeans::pad_means() {
+    const int padded = round_up(num_means, int(means_per_pass));
+    for (int i = num_means; i < padded; ++i)
+	memcpy(&kd_.means[i * dim], &kd_.means[(num_means - 1) * dim], sizeof(int) * dim);
 }
 
 static void init_kmeans(kmeans_data_t &kd, int nsplit) {
-    // get points.
-    kd.points = safe_malloc<int *>(num_points);
-    // We generate the points continously so that it is easy to determine
-    // whether a value can be freed in kmeans_combine
-    inbuf_start = safe_malloc<int>(num_points * dim);
-    for (int i = 0; i < num_points; i++)
-	kd.points[i] = &inbuf_start[i * dim];
-    inbuf_end = (int *)(intptr_t(inbuf_start) + sizeof(int) * num_points * dim - 1);
-    generate_points(kd.points, num_points);
+    // get points. The padding of the last lanes is zero.
+    kd.stride = round_up(size_t(num_points), size_t(lanes));
+    void *p = NULL;
+    if (posix_memalign(&p, JOS_CLINE, sizeof(int) * kd.stride * dim))
+        p = NULL;
+    assert(p);
+    kd.points = (int *)p;
+    memset(kd.points, 0, sizeof(int) * kd.stride * dim);
+    generate_points(kd.points, kd.stride, num_points);
     // get means
-    kd.means = safe_malloc<keyval_t>(num_means);
-    for (int i = 0; i < num_means; ++i) {
-	kd.means[i].val = safe_malloc<int>(dim);
-	kd.means[i].key = safe_malloc<int>();
-	memcpy(kd.means[i].val, kd.points[i], sizeof(int) * dim);
-	((int *) kd.means[i].key)[0] = i;
-    }
+    kd.means = safe_malloc<int>(round_up(num_means, int(means_per_pass)) * dim);
+    for (int i = 0; i < num_means; ++i)
+	for (int d = 0; d < dim; ++d)
+	    kd.means[i * dim + d] = i < num_points ? kd.points[d * kd.stride + i] : 0;
 
     kd.next_point = 0;
-    kd.unit_size = sizeof(int) * dim;
     kd.nsplits = nsplit;
 
     kd.clusters = safe_malloc<int>(num_points);
@@ -318,12 +291,12 @@ static void init_kmeans(kmeans_data_t &kd, int nsplit) {
 }
 
 int main(int argc, char **argv) {
-    int nprocs = 0, ndisp = 0, map_tasks = 0, reduce_tasks = 0;
+    int nprocs = 0, ndisp = 0, map_tasks = 0;
     int quiet = 0;
     int c;
 
     parse_args(argc, argv);
-    while ((c = getopt(argc - 4, argv + 4, "p:m:l:r:q")) != -1) {
+    while ((c = getopt(argc - 4, argv + 4, "p:m:l:q")) != -1) {
 	switch (c) {
 	case 'p':
 	    assert((nprocs = atoi(optarg)) >= 0);
@@ -331,9 +304,6 @@ int main(int argc, char **argv) {
 	case 'm':
 	    map_tasks = atoi(optarg);
 	    break;
-	case 'r':
-	    reduce_tasks = atoi(optarg);
-	    break;
 	case 'l':
 	    assert((ndisp = atoi(optarg)) >= 0);
 	    break;
@@ -348,39 +318,22 @@ int main(int argc, char **argv) {
     mapreduce_appbase::initialize();
     kmeans app;
     init_kmeans(app.kd_, map_tasks);
-    app.set_reduce_task(reduce_tasks);
+    app.pad_means();
     app.set_ncore(nprocs);
     modified = true;
-    pthread_mutex_init(&lock, NULL);
     while (modified) {
 	modified = false;
 	app.kd_.next_point = 0;
 	dprintf(".");
-	scanned = 0;
-	if (stats) {
-	    free((long *) stats);
-	    stats = NULL;
-	}
         app.sched_run();
-	for (size_t i = 0; i < app.results_.size(); ++i) {
-	    int mean_idx = *((int *)app.results_[i].key);
-	    free(app.kd_.means[mean_idx].val);
-	    app.kd_.means[mean_idx] = app.results_[i];
-	}
-        app.free_results();
+	app.update_means();
     }
     app.print_stats();
     if (!quiet)
 	dump_means(app.kd_.means, num_means);
-    free(inbuf_start);
     free(app.kd_.points);
-    for (int i = 0; i < num_means; i++) {
-	free(app.kd_.means[i].key);
-	free(app.kd_.means[i].val);
-    }
     free(app.kd_.clusters);
     free(app.kd_.means);
-    pthread_mutex_destroy(&lock);
     mapreduce_appbase::deinitialize();
     return 0;
 }
@@ -40,6 +40,7 @@
 #include "application.hh"
 #include "defsplitter.hh"
 #include "bench.hh"
+#include "dense.hh"
 
 enum { pre_fault = 0 };
 
@@ -54,32 +55,19 @@ enum {
     KEY_SXX,
     KEY_SYY,
     KEY_SXY,
+    KEY_NUM,
 };
 
-struct lr : public map_reduce {
-    lr(const char *f, int nsplit) : s_(f, nsplit) {
+struct lr : public map_dense<long long> {
+    lr(const char *f, int nsplit) : map_dense<long long>(KEY_NUM), s_(f, nsplit) {
         s_.trim(round_down(s_.size(), sizeof(POINT_T)));
         if (pre_fault)
-            printf("ignore this %d\n", s_.prefault());
-    }
-    int key_compare(const void *v1, const void *v2) {
-        prof_enterkcmp();
-        long int i1 = (long int) v1;
-        long int i2 = (long int) v2;
-        int r = i2 - i1;
-       prof_leavekcmp();
-       return r;
+            s_.prefault();
     }
     bool split(split_t *ma, int ncores) {
         return s_.split(ma, ncores, NULL, sizeof(POINT_T));
     }
-    unsigned partition(void *k, int length) {
-        assert(length == sizeof(void *));
-        return unsigned(intptr_t(k));
-    }
     void map_function(split_t *);
-    void reduce_function(void *k, void **v, size_t length);
-    int combine_function(void *k, void **v, size_t length);
     defsplitter s_;
 };
 
@@ -100,35 +88,13 @@ void lr::map_function(split_t *args) {
 	SYY += data[i].y * data[i].y;
 	SXY += data[i].x * data[i].y;
     }
+    long long *sum = local();
+    sum[KEY_SX] += SX;
+    sum[KEY_SXX] += SXX;
+    sum[KEY_SY] += SY;
+    sum[KEY_SYY] += SYY;
+    sum[KEY_SXY] += SXY;
     prof_leaveapp();
-    map_emit((void *) KEY_SX, (void *) SX, sizeof(void *));
-    map_emit((void *) KEY_SXX, (void *) SXX, sizeof(void *));
-    map_emit((void *) KEY_SY, (void *) SY, sizeof(void *));
-    map_emit((void *) KEY_SYY, (void *) SYY, sizeof(void *));
-    map_emit((void *) KEY_SXY, (void *) SXY, sizeof(void *));
-}
-
-void lr::reduce_function(void *key_in, void **vals_in, size_t vals_len) {
-    prof_enterapp();
-    long long *vals = (long long *) vals_in;
-    long long sum = 0;
-    assert(vals);
-    for (size_t i = 0; i < vals_len; i++)
-	sum += (uint64_t) vals[i];
-    prof_enterapp();
-    reduce_emit(key_in, (void *) sum);
-}
-
-int lr::combine_function(void *, void **vals_in, size_t vals_len) {
-    prof_enterapp();
-    long long *vals = (long long *) vals_in;
-    long long sum = 0;
-    assert(vals);
-    for (size_t i = 0; i < vals_len; ++i)
-	sum += vals[i];
-    vals[0] = sum;
-    prof_leaveapp();
-    return 1;
 }
 
 static void usage(char *prog) {
@@ -136,7 +102,6 @@ static void usage(char *prog) {
     printf("options:\n");
     printf("  -p #procs : # of processors to use\n");
     printf("  -m #map tasks : # of map tasks (pre-split input before MR)\n");
-    printf("  -r #reduce tasks : # of reduce tasks\n");
     printf("  -l ntops : # of top val. pairs to display\n");
     printf("  -q : quiet output (for batch test)\n");
     printf("  -d : debug output\n");
@@ -175,32 +140,9 @@ int main(int argc, char *argv[]) {
 
     long long n;
     double a, b, xbar, ybar, r2;
-    long long SX_ll = 0, SY_ll = 0, SXX_ll = 0, SYY_ll = 0, SXY_ll = 0;
-    // ADD UP RESULTS
-    for (size_t i = 0; i < app.results_.size(); ++i) {
-	keyval_t *curr = &app.results_[i];
-	switch ((long int) curr->key) {
-	case KEY_SX:
-	    SX_ll = (long long) curr->val;
-	    break;
-	case KEY_SY:
-	    SY_ll = (long long) curr->val;
-	    break;
-	case KEY_SXX:
-	    SXX_ll = (long long) curr->val;
-	    break;
-	case KEY_SYY:
-	    SYY_ll = (long long) curr->val;
-	    break;
-	case KEY_SXY:
-	    SXY_ll = (long long) curr->val;
-	    break;
-	default:
-	    // INVALID KEY
-	    assert(0);
-	    break;
-	}
-    }
+    const long long *sum = app.results();
+    long long SX_ll = sum[KEY_SX], SY_ll = sum[KEY_SY], SXX_ll = sum[KEY_SXX],
+        SYY_ll = sum[KEY_SYY], SXY_ll = sum[KEY_SXY];
 
     double SX = (double) SX_ll;
     double SY = (double) SY_ll;
@@ -231,7 +173,6 @@ int main(int argc, char *argv[]) {
 	printf("\tSYY  = %lld\n", SYY_ll);
 	printf("\tSXY  = %lld\n", SXY_ll);
     }
-    app.free_results();
     mapreduce_appbase::deinitialize();
     return 0;
 }
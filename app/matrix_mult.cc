@@ -47,6 +47,7 @@ int main(int argc, char *argv[]) {
     int *matrix_A_ptr, *matrix_B_ptr, *fdata_out;
     int nprocs = 0, map_tasks = 0;
     int quiet = 0;
+    bool mr = false, naive = false;
     srand((unsigned) time(NULL));
     if (argc < 2) {
 	usage(argv[0]);
@@ -54,7 +55,7 @@ int main(int argc, char *argv[]) {
     }
 
     int c;
-    while ((c = getopt(argc, argv, "p:m:ql:")) != -1) {
+    while ((c = getopt(argc, argv, "p:m:ql:MK")) != -1) {
 	switch (c) {
 	case 'p':
 	    assert((nprocs = atoi(optarg)) >= 0);
@@ -68,6 +69,12 @@ int main(int argc, char *argv[]) {
 	case 'l':
 	    assert((matrix_len = atoi(optarg)) > 0);
 	    break;
+	case 'M':
+	    mr = true;
+	    break;
+	case 'K':
+	    naive = true;
+	    break;
 	default:
 	    usage(argv[0]);
 	    exit(EXIT_FAILURE);
@@ -76,6 +83,7 @@ int main(int argc, char *argv[]) {
     matrix_A_ptr = safe_malloc<int>(matrix_len * matrix_len);
     matrix_B_ptr = safe_malloc<int>(matrix_len * matrix_len);
     fdata_out = safe_malloc<int>(matrix_len * matrix_len);
+    memset(fdata_out, 0, sizeof(int) * matrix_len * matrix_len);
 
     for (int i = 0; i < matrix_len; i++)
 	for (int j = 0; j < matrix_len; j++) {
@@ -92,10 +100,9 @@ int main(int argc, char *argv[]) {
     app.d_.matrix_A = matrix_A_ptr;
     app.d_.matrix_B = matrix_B_ptr;
     app.d_.output = ((int *) fdata_out);
+    app.naive_ = naive;
 
-    app.set_ncore(nprocs);
-    app.sched_run();
-    app.print_stats();
+    mm_run(app, mr, nprocs);
     if (!quiet) {
 	printf("First row of the output matrix:\n");
 	for (int i = 0; i < matrix_len; i++)
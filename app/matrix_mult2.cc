@@ -65,7 +65,7 @@ enum { block_based = 1 };
 
 struct mm2 : public mm {
    mm2(int nsplit, bool block_based) : mm(nsplit, block_based) {}
-   void map_function_block(split_t *);
+   void naive_block(int r0, int r1, int c0, int c1);
 };
 
 /** Extract inner loop to make auto vectorization easier to analyze  */
@@ -76,31 +76,15 @@ void processInnerLoop(int* out, int out_offset, int* mat_a, int a_offset, int *m
 	out[out_offset + i] += a * mat_b[b_offset + i];
 }
 
-/** Multiplies the allocated regions of matrix to compute partial sums */
-void mm2::map_function_block(split_t *args) {
-    int end_i, end_j, end_k, a, c;
-    prof_enterapp();
-    assert(args && args->data);
-    mm_data_t *data = (mm_data_t *) (args->data);
-    dprintf("%d Start Loop \n", data->row_num);
-    int i = data->startrow;
-    int j = data->startcol;
-    dprintf("do %d %d of %d\n", i, j, data->matrix_len);
-    for (int k = 0; k < data->matrix_len; k += block_len) {
-	end_i = i + block_len;
-	end_j = j + block_len;
-	end_k = k + block_len;
-	int end = (end_j < data->matrix_len) ? end_j : data->matrix_len;
-	for (a = i; a < end_i && a < data->matrix_len; ++a)
-            for (c = k; c < end_k && c < data->matrix_len; ++c)
-	        processInnerLoop(data->output, data->matrix_len * a, data->matrix_A, 
-                                 data->matrix_len * a + c, data->matrix_B, 
-                                 data->matrix_len * c, j, end);
+void mm2::naive_block(int r0, int r1, int c0, int c1) {
+    const int n = d_.matrix_len;
+    for (int k = 0; k < n; k += block_len) {
+	const int end_k = std::min(k + block_len, n);
+	for (int a = r0; a < r1; ++a)
+            for (int c = k; c < end_k; ++c)
+	        processInnerLoop(d_.output, n * a, d_.matrix_A, n * a + c,
+                                 d_.matrix_B, n * c, c0, c1);
     }
-    dprintf("Finished Map task %d\n", data->row_num);
-    fflush(stdout);
-    free(data);
-    prof_leaveapp();
 }
 
 int main(int argc, char *argv[]) {
@@ -108,6 +92,7 @@ int main(int argc, char *argv[]) {
     int *matrix_A_ptr, *matrix_B_ptr, *fdata_out;
     int nprocs = 0, map_tasks = 0;
     int quiet = 0;
+    bool mr = false, naive = false;
     srand((unsigned) time(NULL));
     if (argc < 2) {
 	usage(argv[0]);
@@ -115,7 +100,7 @@ int main(int argc, char *argv[]) {
     }
 
     int c;
-    while ((c = getopt(argc, argv, "p:m:ql:")) != -1) {
+    while ((c = getopt(argc, argv, "p:m:ql:MK")) != -1) {
 	switch (c) {
 	case 'p':
 	    assert((nprocs = atoi(optarg)) >= 0);
@@ -129,6 +114,12 @@ int main(int argc, char *argv[]) {
 	case 'l':
 	    assert((matrix_len = atoi(optarg)) > 0);
 	    break;
+	case 'M':
+	    mr = true;
+	    break;
+	case 'K':
+	    naive = true;
+	    break;
 	default:
 	    usage(argv[0]);
 	    exit(EXIT_FAILURE);
@@ -137,6 +128,7 @@ int main(int argc, char *argv[]) {
     matrix_A_ptr = safe_malloc<int>(matrix_len * matrix_len);
     matrix_B_ptr = safe_malloc<int>(matrix_len * matrix_len);
     fdata_out = safe_malloc<int>(matrix_len * matrix_len);
+    memset(fdata_out, 0, sizeof(int) * matrix_len * matrix_len);
 
     for (int i = 0; i < matrix_len; i++)
 	for (int j = 0; j < matrix_len; j++) {
@@ -154,10 +146,9 @@ int main(int argc, char *argv[]) {
     app.d_.matrix_A = matrix_A_ptr;
     app.d_.matrix_B = matrix_B_ptr;
     app.d_.output = ((int *) fdata_out);
+    app.naive_ = naive;
 
-    app.set_ncore(nprocs);
-    app.sched_run();
-    app.print_stats();
+    mm_run(app, mr, nprocs);
     if (!quiet) {
 	printf("First row of the output matrix:\n");
 	for (int i = 0; i < matrix_len; i++)
@@ -1,6 +1,8 @@
 #ifndef MM_HH_
 #define MM_HH_ 1
 #include "application.hh"
+#include "parallel.hh"
+#include "gemm.hh"
 
 enum { block_len = 32 };
 
@@ -22,7 +24,8 @@ struct mm_key_t {
 };
 
 struct mm : public map_only {
-   mm(int nsplit, bool block_based) : nsplit_(nsplit), block_based_(block_based) {}
+   mm(int nsplit, bool block_based)
+       : nsplit_(nsplit), block_based_(block_based), naive_(false) {}
    int key_compare(const void *v1, const void *v2);
    bool split(split_t *ma, int ncores) {
        return block_based_ ? split_block(ma, ncores) : split_nonblock(ma, ncores);
@@ -32,11 +35,17 @@ struct mm : public map_only {
    }
    bool split_block(split_t *ma, int ncores);
    bool split_nonblock(split_t *ma, int ncores);
-   virtual void map_function_block(split_t *ma);
+   void map_function_block(split_t *ma);
    void map_function_nonblock(split_t *ma);
+   /* @brief: add rows [r0, r1) x columns [c0, c1) of the product to the
+      output, with the packed kernel of gemm.hh or with naive_block */
+   void block(int r0, int r1, int c0, int c1);
+   /* @brief: block without packing, as a reference */
+   virtual void naive_block(int r0, int r1, int c0, int c1);
    
    int nsplit_;
    bool block_based_;
+   bool naive_;
    mm_data_t d_;
 };
 
@@ -80,29 +89,11 @@ bool mm::split_nonblock(split_t *out, int ncores) {
 
 /** @brief: Multiplies the allocated regions of matrix to compute partial sums */
 void mm::map_function_nonblock(split_t *args) {
-    int row_count = 0, x_loc, value;
-    int *a_ptr, *b_ptr;
     prof_enterapp();
     assert(args && args->data);
     mm_data_t *data = (mm_data_t *)args->data;
-    while (row_count < int(args->length)) {
-	a_ptr = data->matrix_A + (data->row_num + row_count) * data->matrix_len;
-	for (int i = 0; i < data->matrix_len; i++) {
-	    b_ptr = data->matrix_B + i;
-	    value = 0;
-	    for (int j = 0; j < data->matrix_len; j++) {
-		value += (a_ptr[j] * (*b_ptr));
-		b_ptr += data->matrix_len;
-	    }
-	    x_loc = (data->row_num + row_count);
-	    data->output[x_loc * data->matrix_len + i] = value;
-	    fflush(stdout);
-	}
-	dprintf("%d Loop\n", data->row_num);
-	row_count++;
-    }
-    printf("Finished Map task %d\n", data->row_num);
-    fflush(stdout);
+    block(data->row_num, data->row_num + args->length, 0, data->matrix_len);
+    dprintf("Finished Map task %d\n", data->row_num);
     free(data);
     prof_leaveapp();
 }
@@ -129,31 +120,88 @@ bool mm::split_block(split_t *out, int ncore) {
     return true;
 }
 
+void mm::block(int r0, int r1, int c0, int c1) {
+    if (naive_) {
+        naive_block(r0, r1, c0, c1);
+        return;
+    }
+    const int n = d_.matrix_len;
+    gemm(r1 - r0, c1 - c0, n, &d_.matrix_A[n * r0], n, &d_.matrix_B[c0], n,
+         &d_.output[n * r0 + c0], n);
+}
+
+void mm::naive_block(int r0, int r1, int c0, int c1) {
+    const int n = d_.matrix_len;
+    const int *A = d_.matrix_A, *B = d_.matrix_B;
+    int *out = d_.output;
+    for (int k = 0; k < n; k += block_len) {
+	const int end_k = std::min(k + block_len, n);
+	for (int a = r0; a < r1; a++)
+	    for (int b = c0; b < c1; b++) {
+		int sum = out[n * a + b];
+		for (int c = k; c < end_k; c++)
+		    sum += A[n * a + c] * B[n * c + b];
+		out[n * a + b] = sum;
+	    }
+    }
+}
+
 /* Multiplies the allocated regions of matrix to compute partial sums */
 void mm::map_function_block(split_t * args) {
     prof_enterapp();
     assert(args && args->data);
     mm_data_t *data = (mm_data_t *)args->data;
-    dprintf("%d Start Loop \n", data->row_num);
-    int i = data->startrow;
-    int j = data->startcol;
+    const int i = data->startrow, j = data->startcol;
     dprintf("do %d %d of %d\n", i, j, data->matrix_len);
-    for (int k = 0; k < data->matrix_len; k += block_len) {
-	int end_i = i + block_len;
-	int end_j = j + block_len;
-	int end_k = k + block_len;
-	for (int a = i; a < end_i && a < data->matrix_len; a++)
-	    for (int b = j; b < end_j && b < data->matrix_len; b++)
-		for (int c = k; c < end_k && c < data->matrix_len; c++)
-		    data->output[data->matrix_len * a + b] +=
-			(data->matrix_A[data->matrix_len * a + c] *
-			 data->matrix_B[data->matrix_len * c + b]);
-    }
-    dprintf("Finished Map task %d\n", data->row_num);
+    block(i, std::min(i + block_len, int(data->matrix_len)),
+          j, std::min(j + block_len, int(data->matrix_len)));
     free(data);
     prof_leaveapp();
 }
 
+struct mm_tile {
+    mm_tile(mm *app) : app_(app) {}
+    void operator()(size_t r0, size_t r1, size_t c0, size_t c1) const {
+        app_->block(r0, r1, c0, c1);
+    }
+    mm *app_;
+};
+
+/* @brief: the gemm blocking, with the larger side halved until there are
+   a few tiles per core */
+inline void mm_tile_size(int n, int ncore, size_t *tr, size_t *tc) {
+    const gemm_blocking &b = gemm_get_blocking();
+    size_t r = std::min(b.mc, n), c = std::min(b.nc, n);
+    while (((n + r - 1) / r) * ((n + c - 1) / c) < size_t(4 * ncore)) {
+        if (r >= c && r > size_t(b.mr))
+            r = (r / 2 + b.mr - 1) / b.mr * b.mr;
+        else if (c > size_t(b.nr))
+            c = (c / 2 + b.nr - 1) / b.nr * b.nr;
+        else
+            break;
+    }
+    *tr = r;
+    *tc = c;
+}
+
+/* @brief: compute the product on @nprocs cores (all if 0), with
+   parallel_for_2d over the output tiles, or as a map_only job if @mr */
+inline void mm_run(mm &app, bool mr, int nprocs) {
+    if (mr) {
+	app.set_ncore(nprocs);
+	app.sched_run();
+	app.print_stats();
+	return;
+    }
+    parallel_reset_stats();
+    mm_tile t(&app);
+    size_t tr, tc;
+    mm_tile_size(app.d_.matrix_len, nprocs ? std::min(nprocs, parallel_ncore())
+                                           : parallel_ncore(), &tr, &tc);
+    parallel_for_2d(app.d_.matrix_len, app.d_.matrix_len, tr, tc, t, nprocs);
+    parallel_print_stats();
+}
+
 inline void usage(char *fn) {
     printf("usage: %s [options]\n", fn);
     printf("options:\n");
@@ -161,6 +209,8 @@ inline void usage(char *fn) {
     printf("  -m #map tasks : # of map tasks (pre-split input before MR)\n");
     printf("  -q : quiet output (for batch test)\n");
     printf("  -l : matrix dimentions. (assume squaure)\n");
+    printf("  -M : run as a MapReduce job instead of a parallel loop\n");
+    printf("  -K : use the unpacked reference kernel\n");
 }
 
 #endif
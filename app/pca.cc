@@ -39,6 +39,8 @@
 #include <sched.h>
 #include "application.hh"
 #include "bench.hh"
+#include "parallel.hh"
+#include "gemm.hh"
 
 //#define MAPONLY
 
@@ -93,6 +95,10 @@ struct pca_mean : map_reduce {
         prof_leavekcmp();
         return r;
     }
+    /* @brief: each key is malloc'ed by map_function */
+    bool has_stable_keys() const {
+        return true;
+    }
     bool split(split_t *out, int ncores);
     void map_function(split_t *out);
     void reduce_function(void *key, void **vals, size_t length) {
@@ -198,6 +204,9 @@ struct pca_cov : public map_reduce {
         prof_leavekcmp();
         return r;
     }
+    bool has_stable_keys() const {
+        return true;
+    }
     bool split(split_t *out, int ncore);
     void map_function(split_t *ma);
     void reduce_function(void *key, void **vals, size_t length) {
@@ -294,6 +303,122 @@ void pca_cov::map_function(split_t * args) {
     prof_leaveapp();
 }
 
+/** Mean of each row, with a parallel loop. Also stores the centered rows
+ *  in @d, for pca_cov_tile */
+struct pca_mean_rows {
+    pca_mean_rows(int **matrix, int *mean, int *d) : matrix_(matrix), mean_(mean), d_(d) {}
+    void operator()(size_t b, size_t e) const {
+	for (size_t i = b; i < e; ++i) {
+	    int sum = 0;
+	    for (int j = 0; j < num_cols; j++)
+		sum += matrix_[i][j];
+	    mean_[i] = sum / num_cols;
+	    for (int j = 0; j < num_cols; j++)
+		d_[i * num_cols + j] = matrix_[i][j] - mean_[i];
+	}
+    }
+    int **matrix_;
+    int *mean_;
+    int *d_;
+};
+
+enum { cov_tile = 128 };
+
+/** Covariance of rows [r0, r1) with rows [c0, c1), as the product of the
+ *  centered rows with their transpose (gemm_nt). Only the cells on or above
+ *  the diagonal are stored, row by row in the upper triangle @cov, so the
+ *  tiles below the diagonal have nothing to do. */
+struct pca_cov_tile {
+    pca_cov_tile(const int *d, int *cov) : d_(d), cov_(cov) {}
+    static size_t row_start(size_t i) {
+	return i * num_rows - i * (i - 1) / 2;
+    }
+    void operator()(size_t r0, size_t r1, size_t c0, size_t c1) const {
+	if (c1 <= r0)
+	    return;
+	int sum[cov_tile * cov_tile];
+	const int w = c1 - c0;
+	memset(sum, 0, sizeof(sum));
+	gemm_nt(r1 - r0, w, num_cols, &d_[r0 * num_cols], num_cols, &d_[c0 * num_cols],
+		num_cols, sum, w);
+	for (size_t i = r0; i < r1; ++i) {
+	    int *out = &cov_[row_start(i) - i];
+	    for (size_t j = std::max(i, c0); j < c1; ++j)
+		out[j] = sum[(i - r0) * w + j - c0] / (num_rows - 1);
+	}
+    }
+    const int *d_;
+    int *cov_;
+};
+
+static void pca_parallel(int nprocs, int quiet) {
+    int *mean = safe_malloc<int>(num_rows);
+    int *cov = safe_malloc<int>(num_rows * (num_rows - 1) / 2 + num_rows);
+    int *d = safe_malloc<int>(size_t(num_rows) * num_cols);
+    parallel_reset_stats();
+    parallel_for(0, num_rows, pca_mean_rows(pca_data_.matrix, mean, d), 1,
+		 schedule_static, nprocs);
+    parallel_for_2d(num_rows, num_rows, cov_tile, cov_tile, pca_cov_tile(d, cov),
+		    nprocs);
+    parallel_print_stats();
+
+    cond_printf(!quiet, "\n\nCovariance matrix:\n");
+    for (int i = 0, n = 0; i < num_rows; ++i) {
+	for (int j = i; j < num_rows; ++j, ++n)
+	    cond_printf(!quiet, "%5d ", cov[n]);
+	cond_printf(!quiet, "\n");
+    }
+    free(mean);
+    free(cov);
+    free(d);
+}
+
+static void pca_mapreduce(int nprocs, int map_tasks, int nreduce_tasks, int quiet) {
+    pca_mean m;
+    m.set_ncore(nprocs);
+#ifndef MAPONLY
+    m.set_reduce_task(nreduce_tasks);
+#endif
+    nsplits = map_tasks;
+    m.sched_run();
+    m.print_stats();
+
+    pca_data_.unit_size = sizeof(int) * num_cols * 2;	// size of two rows
+    pca_data_.next_start_row = pca_data_.next_cov_row = 0;
+    pca_data_.mean = m.results_.array();	// array of keys and values - 
+
+    pca_cov cov;
+    cov.set_ncore(nprocs);
+#ifndef MAPONLY
+    cov.set_reduce_task(nreduce_tasks);
+#endif
+    nsplits = map_tasks;
+    cov.sched_run();
+    cov.print_stats();
+
+    assert(int(cov.results_.size()) == (num_rows * (num_rows - 1) / 2 + num_rows));
+    // Free the allocated structures
+    int cnt = 0;
+    int rows = num_rows;
+    cond_printf(!quiet, "\n\nCovariance matrix:\n");
+    for (size_t i = 0; i < cov.results_.size(); ++i) {
+	cond_printf(!quiet, "%5d ", *((int *) (cov.results_[i].val)));
+	++cnt;
+	if (cnt == num_rows) {
+	    cond_printf(!quiet, "\n");
+	    num_rows--;
+	    cnt = 0;
+	}
+	free(cov.results_[i].val);
+	free(cov.results_[i].key);
+    }
+    num_rows = rows;
+    for (int i = 0; i < rows; i++)
+	free(m.results_[i].val);
+    m.free_results();
+    cov.free_results();
+}
+
 static void usage(char *fn) {
     printf("usage: %s [options]\n", fn);
     printf("options:\n");
@@ -305,10 +430,12 @@ static void usage(char *fn) {
     printf("  -R row : # of matrix\n");
     printf("  -C col : # of matrix\n");
     printf("  -M max : # of max number\n");
+    printf("  -X : run as MapReduce jobs instead of parallel loops\n");
 }
 
 int main(int argc, char **argv) {
     int nprocs = 0, map_tasks = 0, nreduce_tasks = 0, quiet = 0, c;
+    bool mr = false;
     num_rows = DEF_NUM_ROWS;
     num_cols = DEF_NUM_COLS;
     grid_size = DEF_GRID_SIZE;
@@ -318,7 +445,7 @@ int main(int argc, char **argv) {
 	exit(EXIT_FAILURE);
     }
 
-    while ((c = getopt(argc, argv, "p:m:R:M:C:R:r:q")) != -1) {
+    while ((c = getopt(argc, argv, "p:m:R:M:C:R:r:qX")) != -1) {
 	switch (c) {
 	case 'r':
 	    assert((nreduce_tasks = atoi(optarg)) >= 0);
@@ -341,6 +468,9 @@ int main(int argc, char **argv) {
 	case 'M':
 	    assert((grid_size = atoi(optarg)) >= 0);
 	    break;
+	case 'X':
+	    mr = true;
+	    break;
 	default:
 	    usage(argv[0]);
 	    exit(EXIT_FAILURE);
@@ -364,51 +494,13 @@ int main(int argc, char **argv) {
     pca_data_.mean = NULL;
 
     mapreduce_appbase::initialize();
-    pca_mean m;
-    m.set_ncore(nprocs);
-#ifndef MAPONLY
-    m.set_reduce_task(nreduce_tasks);
-#endif
-    nsplits = map_tasks;
-    m.sched_run();
-    m.print_stats();
-
-    pca_data_.unit_size = sizeof(int) * num_cols * 2;	// size of two rows
-    pca_data_.next_start_row = pca_data_.next_cov_row = 0;
-    pca_data_.mean = m.results_.array();	// array of keys and values - 
-
-    pca_cov cov;
-    cov.set_ncore(nprocs);
-#ifndef MAPONLY
-    cov.set_reduce_task(nreduce_tasks);
-#endif
-    nsplits = map_tasks;
-    cov.sched_run();
-    cov.print_stats();
-
-    assert(int(cov.results_.size()) == (num_rows * (num_rows - 1) / 2 + num_rows));
-    // Free the allocated structures
-    int cnt = 0;
-    int rows = num_rows;
-    cond_printf(!quiet, "\n\nCovariance matrix:\n");
-    for (size_t i = 0; i < cov.results_.size(); ++i) {
-	cond_printf(!quiet, "%5d ", *((int *) (cov.results_[i].val)));
-	++cnt;
-	if (cnt == num_rows) {
-	    cond_printf(!quiet, "\n");
-	    num_rows--;
-	    cnt = 0;
-	}
-	free(cov.results_[i].val);
-	free(cov.results_[i].key);
-    }
-    for (int i = 0; i < rows; i++) {
-	free(m.results_[i].val);
+    if (mr)
+	pca_mapreduce(nprocs, map_tasks, nreduce_tasks, quiet);
+    else
+	pca_parallel(nprocs, quiet);
+    for (int i = 0; i < num_rows; i++)
 	free(pca_data_.matrix[i]);
-    }
     free(pca_data_.matrix);
-    m.free_results();
-    cov.free_results();
     mapreduce_appbase::deinitialize();
     return 0;
 }
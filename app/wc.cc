@@ -40,6 +40,7 @@
 #include "application.hh"
 #include "defsplitter.hh"
 #include "bench.hh"
+#include "trace.hh"
 #ifdef JOS_USER
 #include "wc-datafile.h"
 #include <inc/sysprof.h>
@@ -63,6 +64,9 @@ struct wc : public map_reduce {
     int key_compare(const void *s1, const void *s2) {
         return strcmp((const char *) s1, (const char *) s2);
     }
+    uint64_t key_prefix(const void *k) {
+        return xsearch::string_prefix((const char *)k);
+    }
     void map_function(split_t *ma) {
         char k[1024];
         size_t klen;
@@ -100,6 +104,9 @@ struct wc : public map_reduce {
         key[s] = 0;
         return key;
     }
+    bool has_key_copy() const {
+        return true;
+    }
     int final_output_compare(const keyval_t *kv1, const keyval_t *kv2) {
 #ifdef HADOOP
 	return strcmp((char *) kv1->key, (char *) kv2->key);
@@ -117,6 +124,9 @@ struct wc : public map_reduce {
     bool has_value_modifier() const {
         return with_value_modifier;
     }
+    size_t format_result(const keyval_t *kv, char *buf, size_t n) {
+        return snprintf(buf, n, "%18s - %lu\n", (char *)kv->key, (uintptr_t)kv->val);
+    }
   private:
     defsplitter s_;
 };
@@ -138,13 +148,6 @@ static void print_top(xarray<keyval_t> *wc_vals, size_t ndisp) {
     }
 }
 
-static void output_all(xarray<keyval_t> *wc_vals, FILE *fout) {
-    for (uint32_t i = 0; i < wc_vals->size(); i++) {
-	keyval_t *w = wc_vals->at(i);
-	fprintf(fout, "%18s - %lu\n", (char *)w->key,  (uintptr_t)w->val);
-    }
-}
-
 static void usage(char *prog) {
     printf("usage: %s <filename> [options]\n", prog);
     printf("options:\n");
@@ -155,19 +158,37 @@ static void usage(char *prog) {
     printf("  -q : quiet output (for batch test)\n");
     printf("  -a : alphanumeric word count\n");
     printf("  -o filename : save output to a file\n");
+    printf("  -b filename : save output to a file in the binary format of result_file.hh\n");
+    printf("  -d ds : map phase data structure (btree, array, append or partition)\n");
+    printf("  -j filename : append the job statistics as JSON to a file\n");
+    printf("  -t filename : write a timeline of the tasks as Chrome trace JSON\n");
     exit(EXIT_FAILURE);
 }
 
+/* @brief: exit early if @path cannot be opened for writing */
+static void check_output(const char *path) {
+    FILE *f = fopen(path, "w");
+    if (!f) {
+	fprintf(stderr, "unable to open %s: %s\n", path, strerror(errno));
+	exit(EXIT_FAILURE);
+    }
+    fclose(f);
+}
+
 int main(int argc, char *argv[]) {
     int nprocs = 0, map_tasks = 0, ndisp = 5, reduce_tasks = 0;
     int quiet = 0;
+    int map_ds = -1;
+    const char *stats_file = NULL;
+    const char *trace_file = NULL;
     int c;
     if (argc < 2)
 	usage(argv[0]);
     char *fn = argv[1];
-    FILE *fout = NULL;
+    const char *fout = NULL;
+    const char *fbin = NULL;
 
-    while ((c = getopt(argc - 1, argv + 1, "p:s:l:m:r:qao:")) != -1) {
+    while ((c = getopt(argc - 1, argv + 1, "p:s:l:m:r:qao:b:d:j:t:")) != -1) {
 	switch (c) {
 	case 'p':
 	    nprocs = atoi(optarg);
@@ -187,13 +208,31 @@ int main(int argc, char *argv[]) {
 	case 'a':
 	    alphanumeric = 1;
 	    break;
+	case 'd':
+	    if (!strcmp(optarg, "btree"))
+		map_ds = index_btree;
+	    else if (!strcmp(optarg, "array"))
+		map_ds = index_array;
+	    else if (!strcmp(optarg, "append"))
+		map_ds = index_append;
+	    else if (!strcmp(optarg, "partition"))
+		map_ds = index_partition;
+	    else
+		usage(argv[0]);
+	    break;
+	case 'j':
+	    stats_file = optarg;
+	    break;
+	case 't':
+	    trace_file = optarg;
+	    break;
 	case 'o':
-	    fout = fopen(optarg, "w+");
-	    if (!fout) {
-		fprintf(stderr, "unable to open %s: %s\n", optarg,
-			strerror(errno));
-		exit(EXIT_FAILURE);
-	    }
+	    fout = optarg;
+	    check_output(fout);
+	    break;
+	case 'b':
+	    fbin = optarg;
+	    check_output(fbin);
 	    break;
 	default:
 	    usage(argv[0]);
@@ -206,16 +245,29 @@ int main(int argc, char *argv[]) {
     wc app(fn, map_tasks);
     app.set_ncore(nprocs);
     app.set_reduce_task(reduce_tasks);
+    if (map_ds >= 0)
+	app.set_map_ds(map_ds);
+    if (stats_file)
+	app.set_stats_file(stats_file);
+    if (trace_file)
+	trace_enable();
     app.sched_run();
+    if (trace_file && !trace_dump(trace_file))
+	fprintf(stderr, "unable to write %s\n", trace_file);
     app.print_stats();
     /* get the number of results to display */
     if (!quiet)
 	print_top(&app.results_, ndisp);
-    if (fout) {
-	output_all(&app.results_, fout);
-	fclose(fout);
+    int ret = 0;
+    if (fout && !app.write_results(fout, true)) {
+	fprintf(stderr, "unable to write %s\n", fout);
+	ret = EXIT_FAILURE;
+    }
+    if (fbin && !app.write_results(fbin)) {
+	fprintf(stderr, "unable to write %s\n", fbin);
+	ret = EXIT_FAILURE;
     }
     app.free_results();
     mapreduce_appbase::deinitialize();
-    return 0;
+    return ret;
 }
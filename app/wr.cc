@@ -57,15 +57,19 @@ static void usage(const char *prog) {
 	("  -r #reduce tasks : # of reduce tasks (16 tasks per core by default)\n");
     printf("  -l ntops : # of top val. pairs to display\n");
     printf("  -q : quiet output (for batch test)\n");
+    printf("  -e pointer|offset32|varint : encoding of the values (default pointer)\n");
+    printf("  -c : store the results in CSR form\n");
     exit(EXIT_FAILURE);
 }
 
 int main(int argc, char *argv[]) {
     int nprocs = 0, map_tasks = 0, ndisp = 5, reduce_tasks = 0, quiet = 0;
+    value_encoding venc = venc_pointer;
+    bool csr = false;
     int c;
     if (argc < 2)
 	usage(argv[0]);
-    while ((c = getopt(argc - 1, argv + 1, "p:l:m:r:q")) != -1) {
+    while ((c = getopt(argc - 1, argv + 1, "p:l:m:r:qe:c")) != -1) {
 	switch (c) {
 	case 'p':
 	    nprocs = atoi(optarg);
@@ -82,6 +86,12 @@ int main(int argc, char *argv[]) {
 	case 'q':
 	    quiet = 1;
 	    break;
+	case 'e':
+	    venc = parse_value_encoding(optarg);
+	    break;
+	case 'c':
+	    csr = true;
+	    break;
 	default:
 	    usage(argv[0]);
 	    exit(EXIT_FAILURE);
@@ -93,10 +103,26 @@ int main(int argc, char *argv[]) {
     wr app(argv[1], map_tasks);
     app.set_ncore(nprocs);
     app.set_group_task(reduce_tasks);
+    app.set_value_encoding(venc, app.base());
+    app.set_csr_output(csr);
     app.sched_run();
     app.print_stats();
-    if (!quiet)
-	print_top(&app.results_, ndisp, count(&app.results_));
+    if (!quiet) {
+	size_t nw;
+	if (csr) {
+	    nw = count(&app.csr_);
+	    print_top(&app.csr_, ndisp, nw);
+	} else {
+	    nw = count(&app.results_);
+	    print_top(&app.results_, ndisp, nw);
+	}
+	if (venc != venc_pointer || csr) {
+	    size_t nbad;
+	    size_t bytes = check_postings(app, &nbad);
+	    printf("values: %zu bytes, %.2f bytes per value, %zu bad\n",
+		   bytes, double(bytes) / nw, nbad);
+	}
+    }
     app.free_results();
     mapreduce_appbase::deinitialize();
     return 0;
@@ -3,6 +3,7 @@
 
 #include "application.hh"
 #include "defsplitter.hh"
+#include <strings.h>
 
 struct wr : public map_group {
     wr(char *d, size_t size, int nsplit) : s_(d, size, nsplit) {}
@@ -23,15 +24,25 @@ struct wr : public map_group {
     int key_compare(const void *k1, const void *k2) {
         return strcmp((const char *)k1, (const char *)k2);
     }
+    uint64_t key_prefix(const void *k) {
+        return xsearch::string_prefix((const char *)k);
+    }
     void *key_copy(void *src, size_t s) {
         char *key = safe_malloc<char>(s + 1);
         memcpy(key, src, s);
         key[s] = 0;
         return key;
     }
+    bool has_key_copy() const {
+        return true;
+    }
     void key_free(void *k) {
         free(k);
     }
+    /* @brief: the input, which the values point into */
+    const char *base() const {
+        return s_.data();
+    }
   private:
     defsplitter s_;
 };
@@ -53,4 +64,47 @@ inline void print_top(xarray<keyvals_len_t> *wc_vals, size_t ndisp, size_t nw) {
     }
 }
 
+inline size_t count(keyvals_csr_t *wc_vals) {
+    return wc_vals->size() ? size_t(wc_vals->offsets[wc_vals->size()]) : 0;
+}
+
+inline void print_top(keyvals_csr_t *wc_vals, size_t ndisp, size_t nw) {
+    printf("\nwordreverseindex: results (TOP %zd from %zu keys, %zd words):\n",
+           ndisp, wc_vals->size(), nw);
+    ndisp = std::min(ndisp, wc_vals->size());
+    for (size_t i = 0; i < ndisp; ++i)
+	printf("%15s - %d\n", (char *) wc_vals->keys[i], unsigned(wc_vals->len(i)));
+}
+
+/* @brief: parse the -e option */
+inline value_encoding parse_value_encoding(const char *s) {
+    if (!strcmp(s, "pointer"))
+        return venc_pointer;
+    if (!strcmp(s, "offset32"))
+        return venc_offset32;
+    if (!strcmp(s, "varint"))
+        return venc_varint;
+    eprint("unknown value encoding %s\n", s);
+}
+
+/* @brief: decode the values of all keys, and check that each one points
+   to an occurrence of its (upper case) key.
+   @return: the bytes taken by the value lists */
+inline size_t check_postings(wr &app, size_t *nbad) {
+    const bool csr = app.csr_.size() > 0;
+    const size_t n = csr ? app.csr_.size() : app.results_.size();
+    size_t bytes = 0;
+    *nbad = 0;
+    for (size_t i = 0; i < n; ++i) {
+        const char *k = (const char *) (csr ? app.csr_.keys[i] : app.results_[i].key);
+        const size_t klen = strlen(k);
+        posting_iterator it = csr ? app.values(i) : app.values(app.results_[i]);
+        for (; it.valid(); it.next())
+            *nbad += strncasecmp((const char *) *it, k, klen) != 0;
+        bytes += csr ? app.csr_.len(i) * value_width(app.get_value_encoding())
+            : posting_bytes(app.get_value_encoding(), app.results_[i]);
+    }
+    return bytes;
+}
+
 #endif
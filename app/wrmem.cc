@@ -40,6 +40,7 @@
 #include "bench.hh"
 #include "wr.hh"
 #include "test_util.hh"
+#include "hugemem.hh"
 
 #define DEFAULT_NDISP 10
 
@@ -52,6 +53,8 @@ static void usage(char *prog) {
     printf("  -l ntops : # of top key/value pairs to display\n");
     printf("  -s inputsize : size of input in MB\n");
     printf("  -q : quiet output (for batch test)\n");
+    printf("  -e pointer|offset32|varint : encoding of the values (default pointer)\n");
+    printf("  -c : store the results in CSR form\n");
     exit(EXIT_FAILURE);
 }
 
@@ -59,8 +62,10 @@ int main(int argc, char *argv[]) {
     affinity_set(0);
     int nprocs = 0, map_tasks = 0, ndisp = 5, reduce_tasks = 0, quiet = 0;
     uint64_t inputsize = 0x80000000;
+    value_encoding venc = venc_pointer;
+    bool csr = false;
     int c;
-    while ((c = getopt(argc, argv, "p:l:m:r:qs:")) != -1) {
+    while ((c = getopt(argc, argv, "p:l:m:r:qs:e:c")) != -1) {
 	switch (c) {
 	case 'p':
 	    nprocs = atoi(optarg);
@@ -80,6 +85,12 @@ int main(int argc, char *argv[]) {
 	case 'q':
 	    quiet = 1;
 	    break;
+	case 'e':
+	    venc = parse_value_encoding(optarg);
+	    break;
+	case 'c':
+	    csr = true;
+	    break;
 	default:
 	    usage(argv[0]);
 	    exit(EXIT_FAILURE);
@@ -88,9 +99,7 @@ int main(int argc, char *argv[]) {
     }
     enum { wordlength = 3 };
     uint32_t seed = 0;
-    char *fdata = (char *) mmap(NULL, inputsize + 1, PROT_READ | PROT_WRITE,
-	MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-    assert(fdata != MAP_FAILED);
+    char *fdata = (char *) hugemem_alloc(inputsize + 1);
     uint64_t pos = 0;
     size_t n = 0;
     for (uint64_t i = 0; i < inputsize / (wordlength + 1); ++i, ++n) {
@@ -104,13 +113,26 @@ int main(int argc, char *argv[]) {
     wr app(fdata, inputsize, map_tasks);
     app.set_ncore(nprocs);
     app.set_group_task(reduce_tasks);
+    app.set_value_encoding(venc, app.base());
+    app.set_csr_output(csr);
     app.sched_run();
     app.print_stats();
-    size_t nw = count(&app.results_);
+    size_t nw = csr ? count(&app.csr_) : count(&app.results_);
     CHECK_EQ(n, nw);
-    if (!quiet)
-	print_top(&app.results_, ndisp, nw);
+    size_t nbad;
+    size_t bytes = check_postings(app, &nbad);
+    CHECK_EQ(nbad, size_t(0));
+    if (!quiet) {
+	if (csr)
+	    print_top(&app.csr_, ndisp, nw);
+	else
+	    print_top(&app.results_, ndisp, nw);
+	if (venc != venc_pointer || csr)
+	    printf("values: %zu bytes, %.2f bytes per value\n",
+		   bytes, double(bytes) / nw);
+    }
     app.free_results();
     mapreduce_appbase::deinitialize();
+    hugemem_free(fdata, inputsize + 1);
     return 0;
 }
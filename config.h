@@ -0,0 +1,36 @@
+/* config.h.  Generated from config.h.in by configure.  */
+/* config.h.in.  Generated from configure.ac by autoheader.  */
+
+/* Define data structure for map phase */
+#define DEFAULT_MAP_DS index_btree
+
+/* map -> merge -> reduce */
+/* #undef MAP_MERGE_REDUCE */
+
+/* Define to the address where bug reports for this package should be sent. */
+#define PACKAGE_BUGREPORT ""
+
+/* Define to the full name of this package. */
+#define PACKAGE_NAME "metis"
+
+/* Define to the full name and version of this package. */
+#define PACKAGE_STRING "metis 0.1"
+
+/* Define to the one symbol short name of this package. */
+#define PACKAGE_TARNAME "metis"
+
+/* Define to the home page for this package. */
+#define PACKAGE_URL ""
+
+/* Define to the version of this package. */
+#define PACKAGE_VERSION "0.1"
+
+/* Define if you want metis to print out profiling results from performance
+   counters */
+/* #undef PROFILE_ENABLED */
+
+/* Define to (Append-map -> Group) -> (psrs-merge, and-reduce) */
+/* #undef SINGLE_APPEND_GROUP_FIRST */
+
+/* Define if you want to use psrs for sorting */
+#define USE_PSRS 1